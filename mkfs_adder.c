@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +8,7 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "vsfs_io.h"
 
 #define BS 4096u
 #define INODE_SIZE 128u
@@ -142,7 +144,8 @@ int find_free_inode(uint8_t *inode_bitmap, int max_inodes) {
 }
 
 void print_usage() {
-    printf("Usage: mkfs_adder --input <input_image> --output <output_image> --file <filename>\n");
+    printf("Usage: mkfs_adder --input <input_image> --output <output_image> --file <filename>\n"
+           "                  [--io auto|stdio|uring] [--queue-depth <1..%u>] [--direct]\n", VSFS_IO_MAX_DEPTH);
 }
 
 int main(int argc, char *argv[]) {
@@ -151,6 +154,9 @@ int main(int argc, char *argv[]) {
     char *input_name = NULL;
     char *output_name = NULL;
     char *file_name = NULL;
+    vsfs_io_kind_t io_kind = VSFS_IO_AUTO;
+    uint32_t queue_depth = VSFS_IO_DEFAULT_DEPTH;
+    unsigned io_direct = 0;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -160,6 +166,16 @@ int main(int argc, char *argv[]) {
             output_name = argv[++i];
         } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
             file_name = argv[++i];
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (vsfs_io_parse_kind(argv[++i], &io_kind) != 0) {
+                fprintf(stderr, "Error: Unknown I/O engine '%s'\n", argv[i]);
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            queue_depth = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            io_direct = VSFS_IO_DIRECT;
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
             print_usage();
@@ -174,6 +190,11 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    if (queue_depth < 1 || queue_depth > VSFS_IO_MAX_DEPTH) {
+        fprintf(stderr, "Error: queue-depth must be between 1-%u\n", VSFS_IO_MAX_DEPTH);
+        return 1;
+    }
+    
     // Check if file to add exists and is a regular file
     struct stat file_stat;
     if (stat(file_name, &file_stat) != 0) {
@@ -187,43 +208,37 @@ int main(int argc, char *argv[]) {
     }
     
     // Open input image
-    FILE *input_fp = fopen(input_name, "rb");
-    if (!input_fp) {
+    vsfs_io_t in_io;
+    if (vsfs_io_open(&in_io, input_name, VSFS_IO_RDONLY | io_direct, io_kind, queue_depth) != 0) {
         fprintf(stderr, "Error: Cannot open input image '%s': %s\n", input_name, strerror(errno));
         return 1;
     }
     
-    // Read superblock
+    // Read superblock (whole block, so O_DIRECT sees an aligned length)
     superblock_t sb;
-    fseek(input_fp, 0, SEEK_SET);
-    if (fread(&sb, sizeof(sb), 1, input_fp) != 1) {
+    _Alignas(VSFS_IO_ALIGN) uint8_t sb_block[BS];
+    if (vsfs_io_read(&in_io, sb_block, BS, 0) != 0 || vsfs_io_flush(&in_io) != 0) {
         fprintf(stderr, "Error reading superblock\n");
-        fclose(input_fp);
+        vsfs_io_close(&in_io);
         return 1;
     }
+    memcpy(&sb, sb_block, sizeof(sb));
     
     // Validate magic number
     if (sb.magic != 0x4D565346) {
         fprintf(stderr, "Error: Invalid file system magic number\n");
-        fclose(input_fp);
+        vsfs_io_close(&in_io);
         return 1;
     }
     
-    // Read inode bitmap
-    uint8_t inode_bitmap[BS];
-    fseek(input_fp, sb.inode_bitmap_start * BS, SEEK_SET);
-    if (fread(inode_bitmap, BS, 1, input_fp) != 1) {
-        fprintf(stderr, "Error reading inode bitmap\n");
-        fclose(input_fp);
-        return 1;
-    }
-    
-    // Read data bitmap
-    uint8_t data_bitmap[BS];
-    fseek(input_fp, sb.data_bitmap_start * BS, SEEK_SET);
-    if (fread(data_bitmap, BS, 1, input_fp) != 1) {
-        fprintf(stderr, "Error reading data bitmap\n");
-        fclose(input_fp);
+    // Read inode and data bitmaps together
+    _Alignas(VSFS_IO_ALIGN) uint8_t inode_bitmap[BS];
+    _Alignas(VSFS_IO_ALIGN) uint8_t data_bitmap[BS];
+    vsfs_io_read(&in_io, inode_bitmap, BS, sb.inode_bitmap_start * BS);
+    vsfs_io_read(&in_io, data_bitmap, BS, sb.data_bitmap_start * BS);
+    if (vsfs_io_flush(&in_io) != 0) {
+        fprintf(stderr, "Error reading bitmaps\n");
+        vsfs_io_close(&in_io);
         return 1;
     }
     
@@ -231,7 +246,7 @@ int main(int argc, char *argv[]) {
     int free_inode_idx = find_free_inode(inode_bitmap, sb.inode_count);
     if (free_inode_idx == -1) {
         fprintf(stderr, "Error: No free inodes available\n");
-        fclose(input_fp);
+        vsfs_io_close(&in_io);
         return 1;
     }
     
@@ -241,7 +256,7 @@ int main(int argc, char *argv[]) {
     
     if (blocks_needed > DIRECT_MAX) {
         fprintf(stderr, "Error: File too large (exceeds %d direct blocks)\n", DIRECT_MAX);
-        fclose(input_fp);
+        vsfs_io_close(&in_io);
         return 1;
     }
     
@@ -257,44 +272,29 @@ int main(int argc, char *argv[]) {
     if (blocks_found < blocks_needed) {
         fprintf(stderr, "Error: Not enough free data blocks (%d needed, %d available)\n", 
                 blocks_needed, blocks_found);
-        fclose(input_fp);
-        return 1;
-    }
-    
-    // Read entire inode table into memory
-    uint8_t *inode_table = malloc(sb.inode_table_blocks * BS);
-    if (!inode_table) {
-        fprintf(stderr, "Error: Memory allocation for inode table failed\n");
-        fclose(input_fp);
-        return 1;
-    }
-    fseek(input_fp, sb.inode_table_start * BS, SEEK_SET);
-    if (fread(inode_table, sb.inode_table_blocks * BS, 1, input_fp) != 1) {
-        fprintf(stderr, "Error reading inode table\n");
-        free(inode_table);
-        fclose(input_fp);
+        vsfs_io_close(&in_io);
         return 1;
     }
     
-    // Read entire data region into memory
-    uint8_t *data_region = malloc(sb.data_region_blocks * BS);
-    if (!data_region) {
-        fprintf(stderr, "Error: Memory allocation for data region failed\n");
+    // Read entire inode table and data region into memory in one batch
+    uint8_t *inode_table = vsfs_io_alloc(sb.inode_table_blocks * BS);
+    uint8_t *data_region = vsfs_io_alloc(sb.data_region_blocks * BS);
+    if (!inode_table || !data_region) {
+        fprintf(stderr, "Error: Memory allocation for inode table and data region failed\n");
         free(inode_table);
-        fclose(input_fp);
+        free(data_region);
+        vsfs_io_close(&in_io);
         return 1;
     }
-    fseek(input_fp, sb.data_region_start * BS, SEEK_SET);
-    if (fread(data_region, sb.data_region_blocks * BS, 1, input_fp) != 1) {
-        fprintf(stderr, "Error reading data region\n");
+    vsfs_io_read(&in_io, inode_table, sb.inode_table_blocks * BS, sb.inode_table_start * BS);
+    vsfs_io_read(&in_io, data_region, sb.data_region_blocks * BS, sb.data_region_start * BS);
+    if (vsfs_io_close(&in_io) != 0) { // Done with the input file
+        fprintf(stderr, "Error reading inode table and data region: %s\n", strerror(in_io.err));
         free(inode_table);
         free(data_region);
-        fclose(input_fp);
         return 1;
     }
     
-    fclose(input_fp); // Done with the input file
-    
     // --- Start modifying the file system in memory ---
 
     // 1. Mark inode and data blocks as used in bitmaps
@@ -380,26 +380,59 @@ int main(int argc, char *argv[]) {
     superblock_crc_finalize(&sb);
 
     // --- Write everything to the output file ---
-    FILE *output_fp = fopen(output_name, "wb");
-    if (!output_fp) {
-        fprintf(stderr, "Error: Cannot create output image '%s': %s\n", output_name, strerror(errno));
-        free(inode_table);
-        free(data_region);
-        return 1;
+    memset(sb_block, 0, BS);
+    memcpy(sb_block, &sb, sizeof(sb));
+
+    // A new output image starts as a clone of the input, so only the blocks
+    // modified above have to be written. Never clone onto the input itself.
+    vsfs_io_t out_io;
+    int patched = 0;
+    if (!vsfs_io_same_file(input_name, output_name) &&
+        vsfs_io_clone_file(input_name, output_name) == 0 &&
+        vsfs_io_open(&out_io, output_name, VSFS_IO_RDWR | io_direct, io_kind, queue_depth) == 0) {
+        uint64_t new_inode_block = (uint64_t)free_inode_idx * INODE_SIZE / BS;
+        uint64_t root_inode_block = (uint64_t)(ROOT_INO - 1) * INODE_SIZE / BS;
+
+        vsfs_io_write(&out_io, sb_block, BS, 0);
+        vsfs_io_write(&out_io, inode_bitmap, BS, sb.inode_bitmap_start * BS);
+        vsfs_io_write(&out_io, data_bitmap, BS, sb.data_bitmap_start * BS);
+        vsfs_io_write(&out_io, inode_table + new_inode_block * BS, BS,
+                      (sb.inode_table_start + new_inode_block) * BS);
+        if (root_inode_block != new_inode_block) {
+            vsfs_io_write(&out_io, inode_table + root_inode_block * BS, BS,
+                          (sb.inode_table_start + root_inode_block) * BS);
+        }
+        vsfs_io_write(&out_io, root_dir_data, BS, (sb.data_region_start + root_dir_block_idx) * BS);
+        for (uint32_t i = 0; i < blocks_needed; i++) {
+            vsfs_io_write(&out_io, data_region + data_blocks_indices[i] * BS, BS,
+                          (sb.data_region_start + data_blocks_indices[i]) * BS);
+        }
+        // If patching failed part-way, rewrite the whole image below instead.
+        patched = vsfs_io_close(&out_io) == 0;
     }
 
-    // Write superblock, bitmaps, inode table, and data region
-    fwrite(&sb, sizeof(sb), 1, output_fp);
-    // Pad the rest of the superblock block with zeros
-    uint8_t sb_pad[BS - sizeof(sb)] = {0};
-    fwrite(sb_pad, 1, sizeof(sb_pad), output_fp);
-    
-    fwrite(inode_bitmap, BS, 1, output_fp);
-    fwrite(data_bitmap, BS, 1, output_fp);
-    fwrite(inode_table, sb.inode_table_blocks * BS, 1, output_fp);
-    fwrite(data_region, sb.data_region_blocks * BS, 1, output_fp);
+    if (!patched) {
+        if (vsfs_io_open(&out_io, output_name, VSFS_IO_CREATE | io_direct, io_kind, queue_depth) != 0) {
+            fprintf(stderr, "Error: Cannot create output image '%s': %s\n", output_name, strerror(errno));
+            free(inode_table);
+            free(data_region);
+            return 1;
+        }
+
+        // Write superblock, bitmaps, inode table, and data region
+        vsfs_io_write(&out_io, sb_block, BS, 0);
+        vsfs_io_write(&out_io, inode_bitmap, BS, sb.inode_bitmap_start * BS);
+        vsfs_io_write(&out_io, data_bitmap, BS, sb.data_bitmap_start * BS);
+        vsfs_io_write(&out_io, inode_table, sb.inode_table_blocks * BS, sb.inode_table_start * BS);
+        vsfs_io_write(&out_io, data_region, sb.data_region_blocks * BS, sb.data_region_start * BS);
 
-    fclose(output_fp);
+        if (vsfs_io_close(&out_io) != 0) {
+            fprintf(stderr, "Error writing output image '%s': %s\n", output_name, strerror(out_io.err));
+            free(inode_table);
+            free(data_region);
+            return 1;
+        }
+    }
     free(inode_table);
     free(data_region);
     
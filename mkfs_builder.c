@@ -1,4 +1,5 @@
 // Build: gcc -O2 -std=c17 -Wall -Wextra mkfs_builder.c -o mkfs_builder
+#define _GNU_SOURCE
 #define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +10,7 @@
 #include <time.h>
 #include <assert.h>
 #include <unistd.h>
+#include "vsfs_io.h"
 
 #define BS 4096u               // block size
 #define INODE_SIZE 128u
@@ -129,7 +131,8 @@ void set_bit(uint8_t *bitmap, int bit_num) {
 }
 
 void print_usage() {
-    printf("Usage: mkfs_builder --image <image_name> --size-kib <180..4096> --inodes <128..512>\n");
+    printf("Usage: mkfs_builder --image <image_name> --size-kib <180..4096> --inodes <128..512>\n"
+           "                    [--io auto|stdio|uring] [--queue-depth <1..%u>] [--direct]\n", VSFS_IO_MAX_DEPTH);
 }
 
 int main(int argc, char *argv[]) {
@@ -138,6 +141,9 @@ int main(int argc, char *argv[]) {
     char *image_name = NULL;
     uint32_t size_kib = 0;
     uint32_t inode_count = 0;
+    vsfs_io_kind_t io_kind = VSFS_IO_AUTO;
+    uint32_t queue_depth = VSFS_IO_DEFAULT_DEPTH;
+    unsigned io_mode = VSFS_IO_CREATE;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -147,6 +153,16 @@ int main(int argc, char *argv[]) {
             size_kib = (uint32_t)atoi(argv[++i]);
         } else if (strcmp(argv[i], "--inodes") == 0 && i + 1 < argc) {
             inode_count = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (vsfs_io_parse_kind(argv[++i], &io_kind) != 0) {
+                fprintf(stderr, "Error: Unknown I/O engine '%s'\n", argv[i]);
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            queue_depth = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            io_mode |= VSFS_IO_DIRECT;
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
             print_usage();
@@ -171,6 +187,11 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    if (queue_depth < 1 || queue_depth > VSFS_IO_MAX_DEPTH) {
+        fprintf(stderr, "Error: queue-depth must be between 1-%u\n", VSFS_IO_MAX_DEPTH);
+        return 1;
+    }
+    
     uint64_t total_blocks = (size_kib * 1024) / BS;
     uint64_t inode_table_blocks = (inode_count * INODE_SIZE + BS - 1) / BS; // Round up
     
@@ -240,75 +261,63 @@ int main(int argc, char *argv[]) {
     dirent_checksum_finalize(&dot_entry);
     dirent_checksum_finalize(&dotdot_entry);
     
-    // Write to file
-    FILE *fp = fopen(image_name, "wb");
-    if (!fp) {
-        fprintf(stderr, "Error: Cannot create image file %s: %s\n", image_name, strerror(errno));
+    // Lay out everything up to and including the root directory block in one
+    // buffer; the rest of the data region is written from a shared zero buffer.
+    // All writes are queued at once so the uring engine keeps queue_depth in flight.
+    uint64_t meta_blocks = sb.data_region_start + 1;
+    uint8_t *meta = vsfs_io_alloc(meta_blocks * BS);
+    uint8_t *zero = vsfs_io_alloc(VSFS_IO_MAX_XFER);
+    if (!meta || !zero) {
+        fprintf(stderr, "Error: Memory allocation for image buffers failed\n");
+        free(meta);
+        free(zero);
         return 1;
     }
     
-    // Write superblock
-    uint8_t block[BS] = {0};
-    memcpy(block, &sb, sizeof(sb));
-    if (fwrite(block, BS, 1, fp) != 1) {
-        fprintf(stderr, "Error writing superblock\n");
-        fclose(fp);
-        return 1;
-    }
+    // Superblock
+    memcpy(meta, &sb, sizeof(sb));
     
-    // Write inode bitmap (mark root inode as used)
-    memset(block, 0, BS);
-    set_bit(block, 0); // Root inode (1-indexed, so bit 0)
-    if (fwrite(block, BS, 1, fp) != 1) {
-        fprintf(stderr, "Error writing inode bitmap\n");
-        fclose(fp);
-        return 1;
-    }
+    // Inode bitmap (mark root inode as used)
+    set_bit(meta + sb.inode_bitmap_start * BS, 0); // Root inode (1-indexed, so bit 0)
+    
+    // Data bitmap (mark first data block as used)
+    set_bit(meta + sb.data_bitmap_start * BS, 0); // First data block
+    
+    // Inode table; first block contains root inode
+    memcpy(meta + sb.inode_table_start * BS, &root_inode, sizeof(root_inode));
     
-    // Write data bitmap (mark first data block as used)
-    memset(block, 0, BS);
-    set_bit(block, 0); // First data block
-    if (fwrite(block, BS, 1, fp) != 1) {
-        fprintf(stderr, "Error writing data bitmap\n");
-        fclose(fp);
+    // Root directory data block
+    uint8_t *root_dir = meta + sb.data_region_start * BS;
+    memcpy(root_dir, &dot_entry, sizeof(dot_entry));
+    memcpy(root_dir + sizeof(dot_entry), &dotdot_entry, sizeof(dotdot_entry));
+    
+    vsfs_io_t io;
+    if (vsfs_io_open(&io, image_name, io_mode, io_kind, queue_depth) != 0) {
+        fprintf(stderr, "Error: Cannot create image file %s: %s\n", image_name, strerror(errno));
+        free(meta);
+        free(zero);
         return 1;
     }
     
-    // Write inode table
-    for (uint64_t i = 0; i < inode_table_blocks; i++) {
-        memset(block, 0, BS);
-        if (i == 0) {
-            // First block contains root inode
-            memcpy(block, &root_inode, sizeof(root_inode));
-        }
-        if (fwrite(block, BS, 1, fp) != 1) {
-            fprintf(stderr, "Error writing inode table block %lu\n", i);
-            fclose(fp);
-            return 1;
-        }
-    }
+    int err = vsfs_io_write(&io, meta, meta_blocks * BS, 0);
     
-    // Write root directory data block
-    memset(block, 0, BS);
-    memcpy(block, &dot_entry, sizeof(dot_entry));
-    memcpy(block + sizeof(dot_entry), &dotdot_entry, sizeof(dotdot_entry));
-    if (fwrite(block, BS, 1, fp) != 1) {
-        fprintf(stderr, "Error writing root directory data\n");
-        fclose(fp);
-        return 1;
+    // Remaining data blocks (empty)
+    for (uint64_t b = meta_blocks; b < total_blocks && err == 0; ) {
+        uint64_t n = total_blocks - b;
+        if (n > VSFS_IO_MAX_XFER / BS) n = VSFS_IO_MAX_XFER / BS;
+        err = vsfs_io_write(&io, zero, n * BS, b * BS);
+        b += n;
     }
     
-    // Write remaining data blocks (empty)
-    memset(block, 0, BS);
-    for (uint64_t i = 1; i < sb.data_region_blocks; i++) {
-        if (fwrite(block, BS, 1, fp) != 1) {
-            fprintf(stderr, "Error writing data block %lu\n", i);
-            fclose(fp);
-            return 1;
-        }
+    if (vsfs_io_close(&io) != 0 || err != 0) {
+        fprintf(stderr, "Error writing image file %s: %s\n", image_name, strerror(io.err));
+        free(meta);
+        free(zero);
+        return 1;
     }
+    free(meta);
+    free(zero);
     
-    fclose(fp);
     printf("File system image '%s' created successfully\n", image_name);
     printf("Total blocks: %lu, Inodes: %u\n", total_blocks, inode_count);
     
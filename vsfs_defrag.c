@@ -0,0 +1,452 @@
+// Build: gcc -O2 -std=c17 -Wall -Wextra vsfs_defrag.c -o vsfs_defrag
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vsfs_io.h"
+
+#define BS 4096u
+#define INODE_SIZE 128u
+#define ROOT_INO 1u
+#define DIRECT_MAX 12
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t total_blocks;
+    uint64_t inode_count;
+    uint64_t inode_bitmap_start;
+    uint64_t inode_bitmap_blocks;
+    uint64_t data_bitmap_start;
+    uint64_t data_bitmap_blocks;
+    uint64_t inode_table_start;
+    uint64_t inode_table_blocks;
+    uint64_t data_region_start;
+    uint64_t data_region_blocks;
+    uint64_t root_inode;
+    uint64_t mtime_epoch;
+    uint32_t flags;
+    
+    // THIS FIELD SHOULD STAY AT THE END
+    // ALL OTHER FIELDS SHOULD BE ABOVE THIS
+    uint32_t checksum;          // crc32(superblock[0..4091])
+} superblock_t;
+#pragma pack(pop)
+_Static_assert(sizeof(superblock_t) == 116, "superblock must fit in one block");
+
+#pragma pack(push,1)
+typedef struct {
+    uint16_t mode;
+    uint16_t links;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size_bytes;
+    uint64_t atime;
+    uint64_t mtime;
+    uint64_t ctime;
+    uint32_t direct[DIRECT_MAX];
+    uint32_t reserved_0;
+    uint32_t reserved_1;
+    uint32_t reserved_2;
+    uint32_t proj_id;
+    uint32_t uid16_gid16;
+    uint64_t xattr_ptr;
+
+    // THIS FIELD SHOULD STAY AT THE END
+    // ALL OTHER FIELDS SHOULD BE ABOVE THIS
+    uint64_t inode_crc;   // low 4 bytes store crc32 of bytes [0..119]; high 4 bytes 0
+
+} inode_t;
+#pragma pack(pop)
+_Static_assert(sizeof(inode_t)==INODE_SIZE, "inode size mismatch");
+
+#pragma pack(push,1)
+typedef struct {
+    uint32_t inode_no;
+    uint8_t  type;
+    char     name[58];
+    uint8_t  checksum; // XOR of bytes 0..62
+} dirent64_t;
+#pragma pack(pop)
+_Static_assert(sizeof(dirent64_t)==64, "dirent size mismatch");
+
+
+// ==========================DO NOT CHANGE THIS PORTION=========================
+// These functions are there for your help. You should refer to the specifications to see how you can use them.
+// ====================================CRC32====================================
+uint32_t CRC32_TAB[256];
+void crc32_init(void){
+    for (uint32_t i=0;i<256;i++){
+        uint32_t c=i;
+        for(int j=0;j<8;j++) c = (c&1)?(0xEDB88320u^(c>>1)):(c>>1);
+        CRC32_TAB[i]=c;
+    }
+}
+uint32_t crc32(const void* data, size_t n){
+    const uint8_t* p=(const uint8_t*)data; uint32_t c=0xFFFFFFFFu;
+    for(size_t i=0;i<n;i++) c = CRC32_TAB[(c^p[i])&0xFF] ^ (c>>8);
+    return c ^ 0xFFFFFFFFu;
+}
+// ====================================CRC32====================================
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER SUPERBLOCK ELEMENTS HAVE BEEN FINALIZED
+static void superblock_crc_finalize(superblock_t *sb) {
+    sb->checksum = 0;
+    uint32_t s = crc32((void *) sb, sizeof(superblock_t) - 4);
+    sb->checksum = s;
+}
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER INODE ELEMENTS HAVE BEEN FINALIZED
+void inode_crc_finalize(inode_t* ino){
+    uint8_t tmp[INODE_SIZE]; 
+    memcpy(tmp, ino, INODE_SIZE);
+    // zero crc area before computing
+    memset(&tmp[120], 0, 8);
+    uint32_t c = crc32(tmp, 120);
+    ino->inode_crc = (uint64_t)c; // low 4 bytes carry the crc
+}
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER DIRENT ELEMENTS HAVE BEEN FINALIZED
+void dirent_checksum_finalize(dirent64_t* de) {
+    const uint8_t* p = (const uint8_t*)de;
+    uint8_t x = 0;
+    for (int i = 0; i < 63; i++) x ^= p[i];   // covers ino(4) + type(1) + name(58)
+    de->checksum = x;
+}
+
+int get_bit(uint8_t *bitmap, int bit_num) {
+    int byte_idx = bit_num / 8;
+    int bit_idx = bit_num % 8;
+    return (bitmap[byte_idx] >> bit_idx) & 1;
+}
+
+void set_bit(uint8_t *bitmap, int bit_num) {
+    int byte_idx = bit_num / 8;
+    int bit_idx = bit_num % 8;
+    bitmap[byte_idx] |= (1 << bit_idx);
+}
+
+typedef struct {
+    uint32_t files;          // inodes owning at least one data block
+    uint32_t fragmented;     // ... whose blocks are not one ascending run
+    uint32_t extents;        // contiguous runs summed over all files
+    uint32_t used_blocks;
+    uint32_t free_extents;   // runs of free blocks in the data region
+    uint32_t largest_free;
+} frag_stats_t;
+
+// Number of direct[] slots an inode actually uses
+uint32_t inode_block_count(const inode_t *ino) {
+    uint64_t n = (ino->size_bytes + BS - 1) / BS;
+    return n > DIRECT_MAX ? DIRECT_MAX : (uint32_t)n;
+}
+
+void collect_stats(const superblock_t *sb, const uint8_t *inode_bitmap, const uint8_t *data_bitmap,
+                   const uint8_t *inode_table, frag_stats_t *st) {
+    memset(st, 0, sizeof(*st));
+    for (uint32_t i = 0; i < sb->inode_count; i++) {
+        if (!get_bit((uint8_t *)inode_bitmap, i)) continue;
+        const inode_t *ino = (const inode_t *)(inode_table + i * INODE_SIZE);
+        uint32_t n = inode_block_count(ino);
+        if (n == 0) continue;
+        uint32_t extents = 1;
+        for (uint32_t k = 1; k < n; k++) {
+            if (ino->direct[k] != ino->direct[k - 1] + 1) extents++;
+        }
+        st->files++;
+        st->extents += extents;
+        if (extents > 1) st->fragmented++;
+    }
+    uint32_t run = 0;
+    for (uint32_t b = 0; b < sb->data_region_blocks; b++) {
+        if (get_bit((uint8_t *)data_bitmap, b)) {
+            st->used_blocks++;
+            run = 0;
+            continue;
+        }
+        if (run++ == 0) st->free_extents++;
+        if (run > st->largest_free) st->largest_free = run;
+    }
+}
+
+void print_stats(const char *label, const frag_stats_t *st) {
+    printf("%s: %u files, %u fragmented, %u extents (%.2f per file); "
+           "%u blocks used, free space in %u extents (largest %u blocks)\n",
+           label, st->files, st->fragmented, st->extents,
+           st->files ? (double)st->extents / st->files : 0.0,
+           st->used_blocks, st->free_extents, st->largest_free);
+}
+
+void print_usage() {
+    printf("Usage: vsfs_defrag --input <input_image> --output <output_image> [--dry-run]\n"
+           "                   [--io auto|stdio|uring] [--queue-depth <1..%u>] [--direct]\n"
+           "Writing to a separate output is recommended. When --output equals --input the\n"
+           "result is staged in a temporary file beside it and renamed over the input;\n"
+           "that needs free space for a copy of the image unless the filesystem reflinks.\n",
+           VSFS_IO_MAX_DEPTH);
+}
+
+int main(int argc, char *argv[]) {
+    crc32_init();
+    
+    char *input_name = NULL;
+    char *output_name = NULL;
+    int dry_run = 0;
+    vsfs_io_kind_t io_kind = VSFS_IO_AUTO;
+    uint32_t queue_depth = VSFS_IO_DEFAULT_DEPTH;
+    unsigned io_direct = 0;
+    char *tmp_name = NULL;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_name = argv[++i];
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = 1;
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (vsfs_io_parse_kind(argv[++i], &io_kind) != 0) {
+                fprintf(stderr, "Error: Unknown I/O engine '%s'\n", argv[i]);
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            queue_depth = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            io_direct = VSFS_IO_DIRECT;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+    }
+    
+    // Validate arguments
+    if (!input_name || (!output_name && !dry_run)) {
+        fprintf(stderr, "Error: Missing required arguments\n");
+        print_usage();
+        return 1;
+    }
+    
+    if (queue_depth < 1 || queue_depth > VSFS_IO_MAX_DEPTH) {
+        fprintf(stderr, "Error: queue-depth must be between 1-%u\n", VSFS_IO_MAX_DEPTH);
+        return 1;
+    }
+    
+    // Open input image
+    vsfs_io_t in_io;
+    if (vsfs_io_open(&in_io, input_name, VSFS_IO_RDONLY | io_direct, io_kind, queue_depth) != 0) {
+        fprintf(stderr, "Error: Cannot open input image '%s': %s\n", input_name, strerror(errno));
+        return 1;
+    }
+    
+    // Read superblock
+    superblock_t sb;
+    _Alignas(VSFS_IO_ALIGN) uint8_t sb_block[BS];
+    if (vsfs_io_read(&in_io, sb_block, BS, 0) != 0 || vsfs_io_flush(&in_io) != 0) {
+        fprintf(stderr, "Error reading superblock\n");
+        vsfs_io_close(&in_io);
+        return 1;
+    }
+    memcpy(&sb, sb_block, sizeof(sb));
+    
+    // Validate magic number
+    if (sb.magic != 0x4D565346) {
+        fprintf(stderr, "Error: Invalid file system magic number\n");
+        vsfs_io_close(&in_io);
+        return 1;
+    }
+    
+    // Read bitmaps, inode table and data region in one batch. The original
+    // copies are kept so only blocks that actually change get written back.
+    uint64_t it_bytes = sb.inode_table_blocks * BS;
+    uint64_t dr_bytes = sb.data_region_blocks * BS;
+    uint8_t *bitmaps = vsfs_io_alloc(4 * BS);
+    uint8_t *inode_table = vsfs_io_alloc(it_bytes);
+    uint8_t *orig_inode_table = vsfs_io_alloc(it_bytes);
+    uint8_t *data_region = vsfs_io_alloc(dr_bytes);
+    uint8_t *orig_data_region = vsfs_io_alloc(dr_bytes);
+    uint32_t *new_index = malloc(sb.data_region_blocks * sizeof(uint32_t));
+    if (!bitmaps || !inode_table || !orig_inode_table || !data_region || !orig_data_region || !new_index) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        vsfs_io_close(&in_io);
+        goto fail;
+    }
+    uint8_t *inode_bitmap = bitmaps;
+    uint8_t *data_bitmap = bitmaps + BS;
+    uint8_t *orig_inode_bitmap = bitmaps + 2 * BS;
+    uint8_t *orig_data_bitmap = bitmaps + 3 * BS;
+    vsfs_io_read(&in_io, orig_inode_bitmap, BS, sb.inode_bitmap_start * BS);
+    vsfs_io_read(&in_io, orig_data_bitmap, BS, sb.data_bitmap_start * BS);
+    vsfs_io_read(&in_io, orig_inode_table, it_bytes, sb.inode_table_start * BS);
+    vsfs_io_read(&in_io, orig_data_region, dr_bytes, sb.data_region_start * BS);
+    if (vsfs_io_close(&in_io) != 0) {
+        fprintf(stderr, "Error reading input image: %s\n", strerror(in_io.err));
+        goto fail;
+    }
+    memcpy(inode_bitmap, orig_inode_bitmap, BS);
+    memcpy(inode_table, orig_inode_table, it_bytes);
+    
+    frag_stats_t before, after;
+    collect_stats(&sb, orig_inode_bitmap, orig_data_bitmap, orig_inode_table, &before);
+    
+    // --- Plan the relocation ---
+    // Directories go first, right after the inode table, then regular files;
+    // each in inode order, each laid out as one ascending run. A block owned
+    // twice or pointing outside the data region means the image is damaged,
+    // and moving it would only spread the damage.
+    for (uint32_t b = 0; b < sb.data_region_blocks; b++) new_index[b] = UINT32_MAX;
+    uint32_t next = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < sb.inode_count; i++) {
+            if (!get_bit(inode_bitmap, i)) continue;
+            inode_t *ino = (inode_t *)(inode_table + i * INODE_SIZE);
+            int is_dir = (ino->mode & 0170000) == 040000;
+            if (is_dir != (pass == 0)) continue;
+            uint32_t n = inode_block_count(ino);
+            for (uint32_t k = 0; k < n; k++) {
+                uint64_t old = (uint64_t)ino->direct[k] - sb.data_region_start;
+                if (ino->direct[k] < sb.data_region_start || old >= sb.data_region_blocks ||
+                    new_index[old] != UINT32_MAX) {
+                    fprintf(stderr, "Error: Inode %u has an invalid or shared block %u\n",
+                            i + 1, ino->direct[k]);
+                    goto fail;
+                }
+                new_index[old] = next;
+                ino->direct[k] = (uint32_t)(sb.data_region_start + next);
+                next++;
+            }
+        }
+    }
+    
+    // Blocks marked used but owned by no inode are dropped from the bitmap
+    uint32_t leaked = 0;
+    for (uint32_t b = 0; b < sb.data_region_blocks; b++) {
+        if (get_bit(orig_data_bitmap, b) && new_index[b] == UINT32_MAX) leaked++;
+    }
+    
+    // --- Apply the plan in memory ---
+    memset(data_bitmap, 0, BS);
+    memset(data_region, 0, dr_bytes);
+    for (uint32_t b = 0; b < sb.data_region_blocks; b++) {
+        if (new_index[b] == UINT32_MAX) continue;
+        memcpy(data_region + (uint64_t)new_index[b] * BS, orig_data_region + (uint64_t)b * BS, BS);
+        set_bit(data_bitmap, new_index[b]);
+    }
+    // Free blocks that were never used keep their old content; only zero the
+    // ones this pass vacated, so untouched space isn't rewritten.
+    for (uint32_t b = next; b < sb.data_region_blocks; b++) {
+        if (!get_bit(orig_data_bitmap, b)) {
+            memcpy(data_region + (uint64_t)b * BS, orig_data_region + (uint64_t)b * BS, BS);
+        }
+    }
+    for (uint32_t i = 0; i < sb.inode_count; i++) {
+        if (memcmp(inode_table + i * INODE_SIZE, orig_inode_table + i * INODE_SIZE, INODE_SIZE) != 0) {
+            inode_crc_finalize((inode_t *)(inode_table + i * INODE_SIZE));
+        }
+    }
+    collect_stats(&sb, inode_bitmap, data_bitmap, inode_table, &after);
+    
+    print_stats("Before", &before);
+    print_stats("After ", &after);
+    
+    if (dry_run) {
+        if (leaked) printf("Would reclaim %u unreferenced blocks\n", leaked);
+        printf("Dry run: no image written\n");
+        goto done;
+    }
+    
+    // --- Write the result ---
+    // Only differing blocks are written, merged into runs. A new output
+    // starts as a clone of the input; otherwise it is written in full.
+    // Relocation overwrites blocks that on-disk inodes still point to, so
+    // the input is never patched directly: an in-place run goes to a
+    // temporary image that replaces the input only once fully written.
+    sb.mtime_epoch = (uint64_t)time(NULL);
+    superblock_crc_finalize(&sb);
+    memset(sb_block, 0, BS);
+    memcpy(sb_block, &sb, sizeof(sb));
+    
+    if (vsfs_io_same_file(input_name, output_name)) {
+        tmp_name = vsfs_io_temp_beside(output_name, input_name);
+        if (!tmp_name) {
+            fprintf(stderr, "Error: Cannot create temporary image beside '%s': %s\n", output_name, strerror(errno));
+            goto fail;
+        }
+    }
+    const char *target_name = tmp_name ? tmp_name : output_name;
+    
+    int incremental = vsfs_io_clone_file(input_name, target_name) == 0;
+    vsfs_io_t out_io;
+    if (vsfs_io_open(&out_io, target_name, (incremental ? VSFS_IO_RDWR : VSFS_IO_CREATE) | io_direct,
+                     io_kind, queue_depth) != 0) {
+        fprintf(stderr, "Error: Cannot open output image '%s': %s\n", target_name, strerror(errno));
+        goto fail;
+    }
+    
+    uint64_t moved;
+    vsfs_io_write(&out_io, sb_block, BS, 0);
+    if (incremental) {
+        vsfs_io_write_changed(&out_io, inode_bitmap, orig_inode_bitmap, 1, sb.inode_bitmap_start);
+        vsfs_io_write_changed(&out_io, data_bitmap, orig_data_bitmap, 1, sb.data_bitmap_start);
+        vsfs_io_write_changed(&out_io, inode_table, orig_inode_table, sb.inode_table_blocks,
+                              sb.inode_table_start);
+        moved = vsfs_io_write_changed(&out_io, data_region, orig_data_region, sb.data_region_blocks,
+                                      sb.data_region_start);
+    } else {
+        vsfs_io_write(&out_io, inode_bitmap, BS, sb.inode_bitmap_start * BS);
+        vsfs_io_write(&out_io, data_bitmap, BS, sb.data_bitmap_start * BS);
+        vsfs_io_write(&out_io, inode_table, it_bytes, sb.inode_table_start * BS);
+        vsfs_io_write(&out_io, data_region, dr_bytes, sb.data_region_start * BS);
+        moved = sb.data_region_blocks;
+    }
+    if (vsfs_io_close(&out_io) != 0) {
+        fprintf(stderr, "Error writing output image '%s': %s\n", target_name, strerror(out_io.err));
+        goto fail;
+    }
+    
+    if (tmp_name) {
+        if (vsfs_io_replace(tmp_name, output_name) != 0) {
+            fprintf(stderr, "Error: Cannot replace '%s' with '%s': %s\n", output_name, tmp_name, strerror(errno));
+            goto fail;
+        }
+        free(tmp_name);
+        tmp_name = NULL;
+    }
+    
+    if (leaked) printf("Reclaimed %u unreferenced blocks\n", leaked);
+    printf("Rewrote %" PRIu64 " data blocks using %s I/O\n", moved, vsfs_io_name(&out_io));
+    printf("Output image written to '%s'.\n", output_name);
+    
+done:
+    free(bitmaps);
+    free(inode_table);
+    free(orig_inode_table);
+    free(data_region);
+    free(orig_data_region);
+    free(new_index);
+    return 0;
+    
+fail:
+    if (tmp_name) {
+        unlink(tmp_name);
+        free(tmp_name);
+    }
+    free(bitmaps);
+    free(inode_table);
+    free(orig_inode_table);
+    free(data_region);
+    free(orig_data_region);
+    free(new_index);
+    return 1;
+}
@@ -0,0 +1,495 @@
+// vsfs_io.h - block I/O engines shared by the MiniVSFS tools.
+//
+// Requests are queued with vsfs_io_read()/vsfs_io_write() and are only
+// guaranteed complete after vsfs_io_flush(); buffers must stay untouched
+// until then. Two engines are provided:
+//   stdio - the original blocking fseek/fread/fwrite path, always available.
+//   uring - io_uring driven through raw syscalls (no liburing), keeping up to
+//           queue_depth requests in flight, optionally with O_DIRECT. Only
+//           READV/WRITEV are used, so any 5.1+ kernel and uapi header works.
+// VSFS_IO_AUTO picks uring and silently falls back to stdio when the kernel
+// or a seccomp profile refuses io_uring_setup.
+//
+// Include after defining _GNU_SOURCE (O_DIRECT, copy_file_range).
+#ifndef VSFS_IO_H
+#define VSFS_IO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define VSFS_HAVE_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#define VSFS_IO_BLOCK 4096u                // MiniVSFS block size
+#define VSFS_IO_ALIGN 4096u                // O_DIRECT buffer/offset alignment
+#define VSFS_IO_MAX_XFER (256u * 1024u)    // larger requests are split
+#define VSFS_IO_DEFAULT_DEPTH 32u
+#define VSFS_IO_MAX_DEPTH 4096u
+
+typedef enum { VSFS_IO_AUTO, VSFS_IO_STDIO, VSFS_IO_URING } vsfs_io_kind_t;
+
+// Open modes
+#define VSFS_IO_RDONLY 0u
+#define VSFS_IO_RDWR   1u   // existing file, read and patch in place
+#define VSFS_IO_CREATE 2u   // create/truncate for writing
+#define VSFS_IO_DIRECT 4u   // O_DIRECT, uring engine only
+
+typedef struct {
+    vsfs_io_kind_t kind;
+    int err;                // first error seen (errno value), sticky
+    FILE *fp;               // stdio
+
+    int fd;                 // uring
+    int ring_fd;
+#ifdef VSFS_HAVE_URING
+    unsigned depth;
+    unsigned pending;       // queued, not yet submitted
+    unsigned inflight;      // submitted, not yet reaped
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail;
+    struct iovec *iovs;     // one per in-flight request, indexed by user_data
+    unsigned *free_slots;
+    unsigned nfree;
+#endif
+} vsfs_io_t;
+
+static inline const char *vsfs_io_name(const vsfs_io_t *io) {
+    return io->kind == VSFS_IO_URING ? "uring" : "stdio";
+}
+
+static inline int vsfs_io_parse_kind(const char *s, vsfs_io_kind_t *out) {
+    if (strcmp(s, "auto") == 0) *out = VSFS_IO_AUTO;
+    else if (strcmp(s, "stdio") == 0) *out = VSFS_IO_STDIO;
+    else if (strcmp(s, "uring") == 0) *out = VSFS_IO_URING;
+    else return -1;
+    return 0;
+}
+
+// Zeroed buffer aligned for O_DIRECT. Release with free().
+static inline void *vsfs_io_alloc(size_t size) {
+    void *p = NULL;
+    if (posix_memalign(&p, VSFS_IO_ALIGN, size ? size : VSFS_IO_ALIGN) != 0) return NULL;
+    memset(p, 0, size);
+    return p;
+}
+
+// ====================================stdio====================================
+static inline int vsfs_io_stdio_open(vsfs_io_t *io, const char *path, unsigned mode) {
+    const char *fmode = (mode & VSFS_IO_CREATE) ? "w+b" : (mode & VSFS_IO_RDWR) ? "r+b" : "rb";
+    io->fp = fopen(path, fmode);
+    if (!io->fp) return -1;
+    io->kind = VSFS_IO_STDIO;
+    return 0;
+}
+
+static inline int vsfs_io_stdio_rw(vsfs_io_t *io, int is_write, void *buf, size_t len, uint64_t off) {
+    if (fseeko(io->fp, (off_t)off, SEEK_SET) != 0) {
+        if (!io->err) io->err = errno;
+        return -1;
+    }
+    size_t n = is_write ? fwrite(buf, 1, len, io->fp) : fread(buf, 1, len, io->fp);
+    if (n != len) {
+        if (!io->err) io->err = ferror(io->fp) ? EIO : ENODATA;
+        return -1;
+    }
+    return 0;
+}
+
+// ====================================uring====================================
+#ifdef VSFS_HAVE_URING
+#ifdef IORING_FEAT_SINGLE_MMAP
+#define VSFS_IO_URING_SINGLE_MMAP(p) ((p).features & IORING_FEAT_SINGLE_MMAP)
+#else
+#define VSFS_IO_URING_SINGLE_MMAP(p) 0     // pre-5.4 headers have no features field
+#endif
+
+static inline int vsfs_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int vsfs_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline void vsfs_io_uring_unmap(vsfs_io_t *io) {
+    if (io->sqes) munmap(io->sqes, io->sqes_len);
+    if (io->cq_ptr && io->cq_ptr != io->sq_ptr) munmap(io->cq_ptr, io->cq_len);
+    if (io->sq_ptr) munmap(io->sq_ptr, io->sq_len);
+    io->sqes = NULL;
+    io->sq_ptr = io->cq_ptr = NULL;
+    free(io->iovs);
+    free(io->free_slots);
+    io->iovs = NULL;
+    io->free_slots = NULL;
+}
+
+static inline int vsfs_io_uring_init(vsfs_io_t *io, unsigned depth) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    io->ring_fd = vsfs_io_uring_setup(depth, &p);
+    if (io->ring_fd < 0) return -1;
+
+    io->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (VSFS_IO_URING_SINGLE_MMAP(p)) {
+        if (io->cq_len > io->sq_len) io->sq_len = io->cq_len;
+        io->cq_len = io->sq_len;
+    }
+    io->sq_ptr = mmap(NULL, io->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      io->ring_fd, IORING_OFF_SQ_RING);
+    if (io->sq_ptr == MAP_FAILED) {
+        io->sq_ptr = NULL;
+        goto fail;
+    }
+    if (VSFS_IO_URING_SINGLE_MMAP(p)) {
+        io->cq_ptr = io->sq_ptr;
+    } else {
+        io->cq_ptr = mmap(NULL, io->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          io->ring_fd, IORING_OFF_CQ_RING);
+        if (io->cq_ptr == MAP_FAILED) {
+            io->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    io->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    io->ring_fd, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED) {
+        io->sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t *sq = io->sq_ptr, *cq = io->cq_ptr;
+    io->sq_head = (unsigned *)(sq + p.sq_off.head);
+    io->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + p.sq_off.array);
+    io->cq_head = (unsigned *)(cq + p.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    io->sq_local_tail = *io->sq_tail;
+    io->depth = p.sq_entries < depth ? p.sq_entries : depth;
+
+    // READV/WRITEV read the iovec when the request runs, so each in-flight
+    // request keeps its own until it completes.
+    io->iovs = calloc(io->depth, sizeof(struct iovec));
+    io->free_slots = calloc(io->depth, sizeof(unsigned));
+    if (!io->iovs || !io->free_slots) goto fail;
+    for (unsigned i = 0; i < io->depth; i++) io->free_slots[i] = i;
+    io->nfree = io->depth;
+    return 0;
+
+fail:
+    vsfs_io_uring_unmap(io);
+    close(io->ring_fd);
+    io->ring_fd = -1;
+    return -1;
+}
+
+// Consume every available completion; user_data is the iovec slot, whose
+// length is what the request expected, so short transfers are reported as
+// errors just like a short fread/fwrite.
+static inline void vsfs_io_uring_reap(vsfs_io_t *io) {
+    unsigned head = *io->cq_head;
+    unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+        if (cqe->res < 0) {
+            if (!io->err) io->err = -cqe->res;
+        } else if ((size_t)cqe->res != io->iovs[cqe->user_data].iov_len) {
+            if (!io->err) io->err = EIO;
+        }
+        io->free_slots[io->nfree++] = (unsigned)cqe->user_data;
+        head++;
+        io->inflight--;
+    }
+    __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Hand queued sqes to the kernel and, if wait is set, block until at least
+// `wait` completions are available.
+static inline int vsfs_io_uring_submit(vsfs_io_t *io, unsigned wait) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    while (io->pending || wait) {
+        int r = vsfs_io_uring_enter(io->ring_fd, io->pending, wait, flags);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (!io->err) io->err = errno;
+            return -1;
+        }
+        io->pending -= (unsigned)r;
+        io->inflight += (unsigned)r;
+        wait = 0;
+        flags = 0;
+    }
+    vsfs_io_uring_reap(io);
+    return 0;
+}
+
+// Wait until nothing is in flight, whatever fails on the way: the kernel may
+// still be filling caller buffers until each request completes, so neither
+// the ring nor those buffers may go away before this returns. Sqes a failed
+// submit left pending were never handed to the kernel, so they hold nothing.
+static inline void vsfs_io_uring_drain(vsfs_io_t *io) {
+    while (io->inflight) {
+        int r = vsfs_io_uring_enter(io->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (r < 0 && errno != EINTR) {
+            if (!io->err) io->err = errno;
+            usleep(1000);   // the CQ ring is still mapped; keep polling it
+        }
+        vsfs_io_uring_reap(io);
+    }
+}
+
+static inline int vsfs_io_uring_queue(vsfs_io_t *io, int is_write, void *buf, size_t len, uint64_t off) {
+    while (io->pending + io->inflight >= io->depth) {
+        if (vsfs_io_uring_submit(io, 1) != 0) return -1;
+    }
+    unsigned idx = io->sq_local_tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    unsigned slot = io->free_slots[--io->nfree];
+    io->iovs[slot].iov_base = buf;
+    io->iovs[slot].iov_len = len;
+    sqe->opcode = is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = io->fd;
+    sqe->off = off;
+    sqe->addr = (uint64_t)(uintptr_t)&io->iovs[slot];
+    sqe->len = 1;
+    sqe->user_data = slot;
+    io->sq_array[idx] = idx;
+    io->sq_local_tail++;
+    __atomic_store_n(io->sq_tail, io->sq_local_tail, __ATOMIC_RELEASE);
+    io->pending++;
+    return 0;
+}
+
+// Returns -1 if io_uring itself is unavailable, -2 if the file can't be opened.
+static inline int vsfs_io_uring_open(vsfs_io_t *io, const char *path, unsigned mode, unsigned depth) {
+    int flags = (mode & VSFS_IO_CREATE) ? (O_RDWR | O_CREAT | O_TRUNC)
+              : (mode & VSFS_IO_RDWR) ? O_RDWR : O_RDONLY;
+    if (vsfs_io_uring_init(io, depth) != 0) return -1;
+    io->fd = open(path, flags | ((mode & VSFS_IO_DIRECT) ? O_DIRECT : 0), 0666);
+    if (io->fd < 0 && (mode & VSFS_IO_DIRECT) && errno == EINVAL) {
+        fprintf(stderr, "Warning: O_DIRECT not supported for '%s', using buffered I/O\n", path);
+        io->fd = open(path, flags, 0666);
+    }
+    if (io->fd < 0) {
+        int saved = errno;
+        vsfs_io_uring_unmap(io);
+        close(io->ring_fd);
+        io->ring_fd = -1;
+        errno = saved;
+        return -2;
+    }
+    io->kind = VSFS_IO_URING;
+    return 0;
+}
+#endif
+// ====================================uring====================================
+
+// Returns 0 on success, -1 with errno set. With VSFS_IO_AUTO a failed
+// io_uring_setup falls back to stdio; a failed open() is reported as is.
+static inline int vsfs_io_open(vsfs_io_t *io, const char *path, unsigned mode,
+                               vsfs_io_kind_t kind, unsigned depth) {
+    memset(io, 0, sizeof(*io));
+    io->fd = io->ring_fd = -1;
+    if (depth == 0) depth = VSFS_IO_DEFAULT_DEPTH;
+#ifdef VSFS_HAVE_URING
+    if (kind != VSFS_IO_STDIO) {
+        int r = vsfs_io_uring_open(io, path, mode, depth);
+        if (r == 0) return 0;
+        if (r == -2 || kind == VSFS_IO_URING) return -1;
+    }
+#else
+    if (kind == VSFS_IO_URING) {
+        errno = ENOSYS;
+        return -1;
+    }
+#endif
+    if (mode & VSFS_IO_DIRECT) {
+        fprintf(stderr, "Warning: --direct is only honoured by the uring engine\n");
+    }
+    return vsfs_io_stdio_open(io, path, mode);
+}
+
+static inline int vsfs_io_rw(vsfs_io_t *io, int is_write, void *buf, size_t len, uint64_t off) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        size_t n = len < VSFS_IO_MAX_XFER ? len : VSFS_IO_MAX_XFER;
+        int r;
+#ifdef VSFS_HAVE_URING
+        if (io->kind == VSFS_IO_URING) r = vsfs_io_uring_queue(io, is_write, p, n, off);
+        else
+#endif
+        r = vsfs_io_stdio_rw(io, is_write, p, n, off);
+        if (r != 0) return -1;
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static inline int vsfs_io_read(vsfs_io_t *io, void *buf, size_t len, uint64_t off) {
+    return vsfs_io_rw(io, 0, buf, len, off);
+}
+
+static inline int vsfs_io_write(vsfs_io_t *io, const void *buf, size_t len, uint64_t off) {
+    return vsfs_io_rw(io, 1, (void *)buf, len, off);
+}
+
+// Wait for everything queued so far. Returns 0, or -1 with the first error
+// (sticky across calls) in io->err.
+static inline int vsfs_io_flush(vsfs_io_t *io) {
+#ifdef VSFS_HAVE_URING
+    if (io->kind == VSFS_IO_URING) {
+        vsfs_io_uring_submit(io, 0);
+        vsfs_io_uring_drain(io);
+        return io->err ? -1 : 0;
+    }
+#endif
+    if (io->fp && fflush(io->fp) != 0 && !io->err) io->err = errno;
+    return io->err ? -1 : 0;
+}
+
+// Queue writes for every block of `cur` that differs from `orig`, merging
+// adjacent dirty blocks into one request. Both buffers start at block
+// `first_block` of the file. Returns the number of blocks queued.
+static inline uint64_t vsfs_io_write_changed(vsfs_io_t *io, const uint8_t *cur, const uint8_t *orig,
+                                             uint64_t nblocks, uint64_t first_block) {
+    const size_t bs = VSFS_IO_BLOCK;
+    uint64_t written = 0, b = 0;
+    while (b < nblocks) {
+        if (memcmp(cur + b * bs, orig + b * bs, bs) == 0) {
+            b++;
+            continue;
+        }
+        uint64_t start = b;
+        while (b < nblocks && memcmp(cur + b * bs, orig + b * bs, bs) != 0) b++;
+        vsfs_io_write(io, cur + start * bs, (b - start) * bs, (first_block + start) * bs);
+        written += b - start;
+    }
+    return written;
+}
+
+// Flushes, then closes. Returns -1 if anything failed since open.
+static inline int vsfs_io_close(vsfs_io_t *io) {
+    vsfs_io_flush(io);
+#ifdef VSFS_HAVE_URING
+    if (io->kind == VSFS_IO_URING) {
+        vsfs_io_uring_unmap(io);
+        if (io->ring_fd >= 0) close(io->ring_fd);
+        if (io->fd >= 0 && close(io->fd) != 0 && !io->err) io->err = errno;
+        io->fd = io->ring_fd = -1;
+        return io->err ? -1 : 0;
+    }
+#endif
+    if (io->fp && fclose(io->fp) != 0 && !io->err) io->err = errno;
+    io->fp = NULL;
+    return io->err ? -1 : 0;
+}
+
+// Make dst a copy of src without moving the data through user space: FICLONE
+// shares the extents outright (XFS, Btrfs), copy_file_range lets the kernel
+// or filesystem do the copy. Returns 0 on success, or -1 if neither works and
+// the caller should write the whole image itself.
+static inline int vsfs_io_clone_file(const char *src, const char *dst) {
+#ifdef __linux__
+    int in_fd = open(src, O_RDONLY);
+    if (in_fd < 0) return -1;
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        close(in_fd);
+        return -1;
+    }
+    int out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out_fd < 0) {
+        close(in_fd);
+        return -1;
+    }
+
+    int ok = 1;
+    off_t remaining = ioctl(out_fd, FICLONE, in_fd) == 0 ? 0 : st.st_size;
+    while (remaining > 0) {
+        ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, (size_t)remaining, 0);
+        if (n <= 0) {
+            ok = 0;
+            break;
+        }
+        remaining -= n;
+    }
+    close(in_fd);
+    if (close(out_fd) != 0) ok = 0;
+    return ok ? 0 : -1;
+#else
+    (void)src;
+    (void)dst;
+    return -1;
+#endif
+}
+
+// True if both paths name the same existing file.
+static inline int vsfs_io_same_file(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// Create an empty temporary file beside `path`, with the permissions of
+// `mode_from`, to stage a rewrite that later replaces `path` in one rename.
+// Returns a malloc'd name to free(), or NULL with errno set.
+static inline char *vsfs_io_temp_beside(const char *path, const char *mode_from) {
+    struct stat st;
+    if (stat(mode_from, &st) != 0) return NULL;
+    size_t len = strlen(path) + sizeof(".tmp-XXXXXX");
+    char *name = malloc(len);
+    if (!name) return NULL;
+    snprintf(name, len, "%s.tmp-XXXXXX", path);
+    int fd = mkstemp(name);
+    if (fd < 0) {
+        free(name);
+        return NULL;
+    }
+    fchmod(fd, st.st_mode & 07777);
+    close(fd);
+    return name;
+}
+
+// Make a fully written temporary file durable and rename it over `path`.
+// Returns 0, or -1 with errno set; the temporary file is left for the caller.
+static inline int vsfs_io_replace(const char *tmp, const char *path) {
+    int fd = open(tmp, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fsync(fd) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    close(fd);
+    return rename(tmp, path);
+}
+
+#endif // VSFS_IO_H
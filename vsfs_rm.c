@@ -0,0 +1,503 @@
+// Build: gcc -O2 -std=c17 -Wall -Wextra vsfs_rm.c -o vsfs_rm
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vsfs_io.h"
+
+#define BS 4096u
+#define INODE_SIZE 128u
+#define ROOT_INO 1u
+#define DIRECT_MAX 12
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t total_blocks;
+    uint64_t inode_count;
+    uint64_t inode_bitmap_start;
+    uint64_t inode_bitmap_blocks;
+    uint64_t data_bitmap_start;
+    uint64_t data_bitmap_blocks;
+    uint64_t inode_table_start;
+    uint64_t inode_table_blocks;
+    uint64_t data_region_start;
+    uint64_t data_region_blocks;
+    uint64_t root_inode;
+    uint64_t mtime_epoch;
+    uint32_t flags;
+    
+    // THIS FIELD SHOULD STAY AT THE END
+    // ALL OTHER FIELDS SHOULD BE ABOVE THIS
+    uint32_t checksum;          // crc32(superblock[0..4091])
+} superblock_t;
+#pragma pack(pop)
+_Static_assert(sizeof(superblock_t) == 116, "superblock must fit in one block");
+
+#pragma pack(push,1)
+typedef struct {
+    uint16_t mode;
+    uint16_t links;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size_bytes;
+    uint64_t atime;
+    uint64_t mtime;
+    uint64_t ctime;
+    uint32_t direct[DIRECT_MAX];
+    uint32_t reserved_0;
+    uint32_t reserved_1;
+    uint32_t reserved_2;
+    uint32_t proj_id;
+    uint32_t uid16_gid16;
+    uint64_t xattr_ptr;
+
+    // THIS FIELD SHOULD STAY AT THE END
+    // ALL OTHER FIELDS SHOULD BE ABOVE THIS
+    uint64_t inode_crc;   // low 4 bytes store crc32 of bytes [0..119]; high 4 bytes 0
+
+} inode_t;
+#pragma pack(pop)
+_Static_assert(sizeof(inode_t)==INODE_SIZE, "inode size mismatch");
+
+#pragma pack(push,1)
+typedef struct {
+    uint32_t inode_no;
+    uint8_t  type;
+    char     name[58];
+    uint8_t  checksum; // XOR of bytes 0..62
+} dirent64_t;
+#pragma pack(pop)
+_Static_assert(sizeof(dirent64_t)==64, "dirent size mismatch");
+
+
+// ==========================DO NOT CHANGE THIS PORTION=========================
+// These functions are there for your help. You should refer to the specifications to see how you can use them.
+// ====================================CRC32====================================
+uint32_t CRC32_TAB[256];
+void crc32_init(void){
+    for (uint32_t i=0;i<256;i++){
+        uint32_t c=i;
+        for(int j=0;j<8;j++) c = (c&1)?(0xEDB88320u^(c>>1)):(c>>1);
+        CRC32_TAB[i]=c;
+    }
+}
+uint32_t crc32(const void* data, size_t n){
+    const uint8_t* p=(const uint8_t*)data; uint32_t c=0xFFFFFFFFu;
+    for(size_t i=0;i<n;i++) c = CRC32_TAB[(c^p[i])&0xFF] ^ (c>>8);
+    return c ^ 0xFFFFFFFFu;
+}
+// ====================================CRC32====================================
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER SUPERBLOCK ELEMENTS HAVE BEEN FINALIZED
+static void superblock_crc_finalize(superblock_t *sb) {
+    sb->checksum = 0;
+    uint32_t s = crc32((void *) sb, sizeof(superblock_t) - 4);
+    sb->checksum = s;
+}
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER INODE ELEMENTS HAVE BEEN FINALIZED
+void inode_crc_finalize(inode_t* ino){
+    uint8_t tmp[INODE_SIZE]; 
+    memcpy(tmp, ino, INODE_SIZE);
+    // zero crc area before computing
+    memset(&tmp[120], 0, 8);
+    uint32_t c = crc32(tmp, 120);
+    ino->inode_crc = (uint64_t)c; // low 4 bytes carry the crc
+}
+
+// WARNING: CALL THIS ONLY AFTER ALL OTHER DIRENT ELEMENTS HAVE BEEN FINALIZED
+void dirent_checksum_finalize(dirent64_t* de) {
+    const uint8_t* p = (const uint8_t*)de;
+    uint8_t x = 0;
+    for (int i = 0; i < 63; i++) x ^= p[i];   // covers ino(4) + type(1) + name(58)
+    de->checksum = x;
+}
+
+int get_bit(uint8_t *bitmap, int bit_num) {
+    int byte_idx = bit_num / 8;
+    int bit_idx = bit_num % 8;
+    return (bitmap[byte_idx] >> bit_idx) & 1;
+}
+
+void set_bit(uint8_t *bitmap, int bit_num) {
+    int byte_idx = bit_num / 8;
+    int bit_idx = bit_num % 8;
+    bitmap[byte_idx] |= (1 << bit_idx);
+}
+
+void clear_bit(uint8_t *bitmap, int bit_num) {
+    int byte_idx = bit_num / 8;
+    int bit_idx = bit_num % 8;
+    bitmap[byte_idx] &= ~(1 << bit_idx);
+}
+
+typedef struct {
+    char *name;
+    int found;
+} target_t;
+
+int target_cmp(const void *a, const void *b) {
+    return strcmp(((const target_t *)a)->name, ((const target_t *)b)->name);
+}
+
+int add_target(target_t **targets, size_t *count, size_t *cap, const char *name) {
+    if (*count == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 64;
+        target_t *t = realloc(*targets, new_cap * sizeof(target_t));
+        if (!t) return -1;
+        *targets = t;
+        *cap = new_cap;
+    }
+    char *copy = strdup(name);
+    if (!copy) return -1;
+    (*targets)[*count].name = copy;
+    (*targets)[*count].found = 0;
+    (*count)++;
+    return 0;
+}
+
+// One name per line; blank lines are skipped.
+int load_names(const char *path, target_t **targets, size_t *count, size_t *cap) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (add_target(targets, count, cap, line) != 0) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    int err = ferror(fp);
+    fclose(fp);
+    return err ? -1 : 0;
+}
+
+void print_usage() {
+    printf("Usage: vsfs_rm --input <input_image> --output <output_image>\n"
+           "              (--file <name>)... [--names-from <list_file>] [--truncate <bytes>]\n"
+           "              [--io auto|stdio|uring] [--queue-depth <1..%u>] [--direct]\n"
+           "When --output equals --input the result is staged in a temporary file beside\n"
+           "it and renamed over the input.\n", VSFS_IO_MAX_DEPTH);
+}
+
+int main(int argc, char *argv[]) {
+    crc32_init();
+    
+    char *input_name = NULL;
+    char *output_name = NULL;
+    int truncate_mode = 0;
+    uint64_t truncate_size = 0;
+    vsfs_io_kind_t io_kind = VSFS_IO_AUTO;
+    uint32_t queue_depth = VSFS_IO_DEFAULT_DEPTH;
+    unsigned io_direct = 0;
+    target_t *targets = NULL;
+    size_t target_count = 0, target_cap = 0;
+    uint8_t *img = NULL, *orig = NULL;
+    char *tmp_name = NULL;
+    int status = 1;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_name = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            if (add_target(&targets, &target_count, &target_cap, argv[++i]) != 0) {
+                fprintf(stderr, "Error: Memory allocation for file names failed\n");
+                goto out;
+            }
+        } else if (strcmp(argv[i], "--names-from") == 0 && i + 1 < argc) {
+            if (load_names(argv[++i], &targets, &target_count, &target_cap) != 0) {
+                fprintf(stderr, "Error: Cannot read names from '%s': %s\n", argv[i], strerror(errno));
+                goto out;
+            }
+        } else if (strcmp(argv[i], "--truncate") == 0 && i + 1 < argc) {
+            char *end;
+            errno = 0;
+            truncate_size = strtoull(argv[++i], &end, 10);
+            if (errno || *end != '\0' || argv[i][0] == '-') {
+                fprintf(stderr, "Error: Invalid truncate size '%s'\n", argv[i]);
+                goto out;
+            }
+            truncate_mode = 1;
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (vsfs_io_parse_kind(argv[++i], &io_kind) != 0) {
+                fprintf(stderr, "Error: Unknown I/O engine '%s'\n", argv[i]);
+                print_usage();
+                goto out;
+            }
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            queue_depth = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            io_direct = VSFS_IO_DIRECT;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            print_usage();
+            goto out;
+        }
+    }
+    
+    // Validate arguments
+    if (!input_name || !output_name || target_count == 0) {
+        fprintf(stderr, "Error: Missing required arguments\n");
+        print_usage();
+        goto out;
+    }
+    
+    if (queue_depth < 1 || queue_depth > VSFS_IO_MAX_DEPTH) {
+        fprintf(stderr, "Error: queue-depth must be between 1-%u\n", VSFS_IO_MAX_DEPTH);
+        goto out;
+    }
+    
+    if (truncate_mode && truncate_size > (uint64_t)DIRECT_MAX * BS) {
+        fprintf(stderr, "Error: Truncate size exceeds %d direct blocks\n", DIRECT_MAX);
+        goto out;
+    }
+    
+    // Sort once so every directory entry is matched with a binary search,
+    // keeping a batch of thousands of names a single pass over the root.
+    qsort(targets, target_count, sizeof(target_t), target_cmp);
+    size_t unique = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (unique == 0 || strcmp(targets[i].name, targets[unique - 1].name) != 0) {
+            targets[unique++] = targets[i];
+        } else {
+            free(targets[i].name);
+        }
+    }
+    target_count = unique;
+    
+    // Open input image
+    vsfs_io_t in_io;
+    if (vsfs_io_open(&in_io, input_name, VSFS_IO_RDONLY | io_direct, io_kind, queue_depth) != 0) {
+        fprintf(stderr, "Error: Cannot open input image '%s': %s\n", input_name, strerror(errno));
+        goto out;
+    }
+    
+    // Read superblock
+    superblock_t sb;
+    _Alignas(VSFS_IO_ALIGN) uint8_t sb_block[BS];
+    if (vsfs_io_read(&in_io, sb_block, BS, 0) != 0 || vsfs_io_flush(&in_io) != 0) {
+        fprintf(stderr, "Error reading superblock\n");
+        vsfs_io_close(&in_io);
+        goto out;
+    }
+    memcpy(&sb, sb_block, sizeof(sb));
+    
+    // Validate magic number
+    if (sb.magic != 0x4D565346) {
+        fprintf(stderr, "Error: Invalid file system magic number\n");
+        vsfs_io_close(&in_io);
+        goto out;
+    }
+    
+    // Read the whole image; the untouched copy decides which blocks to write
+    uint64_t img_bytes = sb.total_blocks * BS;
+    img = vsfs_io_alloc(img_bytes);
+    orig = vsfs_io_alloc(img_bytes);
+    if (!img || !orig) {
+        fprintf(stderr, "Error: Memory allocation for image failed\n");
+        vsfs_io_close(&in_io);
+        goto out;
+    }
+    vsfs_io_read(&in_io, orig, img_bytes, 0);
+    if (vsfs_io_close(&in_io) != 0) { // Done with the input file
+        fprintf(stderr, "Error reading input image: %s\n", strerror(in_io.err));
+        goto out;
+    }
+    memcpy(img, orig, img_bytes);
+    
+    uint8_t *inode_bitmap = img + sb.inode_bitmap_start * BS;
+    uint8_t *data_bitmap = img + sb.data_bitmap_start * BS;
+    uint8_t *inode_table = img + sb.inode_table_start * BS;
+    inode_t *root_inode = (inode_t*)(inode_table + (ROOT_INO - 1) * INODE_SIZE);
+    time_t now = time(NULL);
+    
+    // --- Match and apply in one pass over the root directory ---
+    uint32_t removed = 0, truncated = 0, freed_inodes = 0, freed_blocks = 0;
+    uint64_t root_entries = root_inode->size_bytes / sizeof(dirent64_t);
+    for (uint64_t e = 0; e < root_entries; e++) {
+        uint64_t blk = e / (BS / sizeof(dirent64_t));
+        if (blk >= DIRECT_MAX || root_inode->direct[blk] < sb.data_region_start ||
+            root_inode->direct[blk] >= sb.total_blocks) break;
+        dirent64_t *entry = (dirent64_t*)(img + (uint64_t)root_inode->direct[blk] * BS) +
+                            e % (BS / sizeof(dirent64_t));
+        if (entry->inode_no == 0 || strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+            continue;
+        }
+        
+        char name[sizeof(entry->name) + 1];
+        memcpy(name, entry->name, sizeof(entry->name));
+        name[sizeof(entry->name)] = '\0';
+        target_t key = { name, 0 };
+        target_t *t = bsearch(&key, targets, target_count, sizeof(target_t), target_cmp);
+        if (!t) continue;
+        t->found = 1;
+        
+        if (entry->inode_no > sb.inode_count) {
+            fprintf(stderr, "Error: '%s' points to inode %u, beyond the %" PRIu64 " in the image\n",
+                    name, entry->inode_no, (uint64_t)sb.inode_count);
+            goto out;
+        }
+        if (entry->type != 1) {
+            fprintf(stderr, "Error: '%s' is not a regular file\n", name);
+            goto out;
+        }
+        uint32_t idx = entry->inode_no - 1;
+        if (!get_bit(inode_bitmap, idx)) {
+            fprintf(stderr, "Error: '%s' points to inode %u, which is not allocated\n",
+                    name, entry->inode_no);
+            goto out;
+        }
+        inode_t *ino = (inode_t*)(inode_table + idx * INODE_SIZE);
+        
+        // Release data blocks past the new end (all of them when removing)
+        uint64_t new_size = truncate_mode ? truncate_size : 0;
+        if (truncate_mode && new_size > ino->size_bytes) {
+            fprintf(stderr, "Error: Cannot extend '%s' (%" PRIu64 " bytes) by truncating\n",
+                    name, (uint64_t)ino->size_bytes);
+            goto out;
+        }
+        int unlink_inode = !truncate_mode && ino->links <= 1;
+        if (truncate_mode || unlink_inode) {
+            uint32_t old_blocks = (ino->size_bytes + BS - 1) / BS;
+            uint32_t keep_blocks = (new_size + BS - 1) / BS;
+            if (old_blocks > DIRECT_MAX) old_blocks = DIRECT_MAX;
+            for (uint32_t k = keep_blocks; k < old_blocks; k++) {
+                // Zero released blocks: mkfs_adder reads a short last block
+                // over whatever a reused block held, which would leak this data
+                if (ino->direct[k] >= sb.data_region_start && ino->direct[k] < sb.total_blocks) {
+                    memset(img + (uint64_t)ino->direct[k] * BS, 0, BS);
+                    clear_bit(data_bitmap, ino->direct[k] - sb.data_region_start);
+                    freed_blocks++;
+                }
+                ino->direct[k] = 0;
+            }
+            // Zero the tail of a partial last block so it reads back as zeros
+            if (new_size % BS && ino->direct[keep_blocks - 1] >= sb.data_region_start &&
+                ino->direct[keep_blocks - 1] < sb.total_blocks) {
+                uint8_t *last = img + (uint64_t)ino->direct[keep_blocks - 1] * BS;
+                memset(last + new_size % BS, 0, BS - new_size % BS);
+            }
+        }
+        
+        if (truncate_mode) {
+            if (new_size != ino->size_bytes) {
+                ino->size_bytes = new_size;
+                ino->mtime = ino->ctime = (uint64_t)now;
+                inode_crc_finalize(ino);
+                truncated++;
+            }
+            continue;
+        }
+        
+        // Removal: clear the dirent so mkfs_adder can reuse the slot
+        memset(entry, 0, sizeof(*entry));
+        if (unlink_inode) {
+            memset(ino, 0, INODE_SIZE);
+            clear_bit(inode_bitmap, idx);
+            freed_inodes++;
+        } else {
+            ino->links--;
+            ino->ctime = (uint64_t)now;
+            inode_crc_finalize(ino);
+        }
+        if (root_inode->links > 2) root_inode->links--;
+        removed++;
+    }
+    
+    // All or nothing: a misspelt name leaves the image untouched
+    int missing = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (!targets[i].found) {
+            fprintf(stderr, "Error: '%s' not found in root directory\n", targets[i].name);
+            missing++;
+        }
+    }
+    if (missing) goto out;
+    
+    // --- Finalize metadata ---
+    if (removed) {
+        root_inode->mtime = root_inode->ctime = (uint64_t)now;
+        inode_crc_finalize(root_inode);
+    }
+    sb.mtime_epoch = (uint64_t)now;
+    superblock_crc_finalize(&sb);
+    memset(img, 0, BS);
+    memcpy(img, &sb, sizeof(sb));
+    
+    // --- Write the result ---
+    // Only blocks that differ from the input are written, merged into runs,
+    // into a clone of the input. The writes are unordered, so the input is
+    // never patched directly: an in-place run goes to a temporary image that
+    // replaces the input only once fully written. Otherwise an interrupted
+    // run could free bitmap bits that a surviving dirent still points at.
+    if (vsfs_io_same_file(input_name, output_name)) {
+        tmp_name = vsfs_io_temp_beside(output_name, input_name);
+        if (!tmp_name) {
+            fprintf(stderr, "Error: Cannot create temporary image beside '%s': %s\n", output_name, strerror(errno));
+            goto out;
+        }
+    }
+    const char *target_name = tmp_name ? tmp_name : output_name;
+    
+    int incremental = vsfs_io_clone_file(input_name, target_name) == 0;
+    vsfs_io_t out_io;
+    if (vsfs_io_open(&out_io, target_name, (incremental ? VSFS_IO_RDWR : VSFS_IO_CREATE) | io_direct,
+                     io_kind, queue_depth) != 0) {
+        fprintf(stderr, "Error: Cannot open output image '%s': %s\n", target_name, strerror(errno));
+        goto out;
+    }
+    if (incremental) {
+        vsfs_io_write_changed(&out_io, img, orig, sb.total_blocks, 0);
+    } else {
+        vsfs_io_write(&out_io, img, img_bytes, 0);
+    }
+    if (vsfs_io_close(&out_io) != 0) {
+        fprintf(stderr, "Error writing output image '%s': %s\n", target_name, strerror(out_io.err));
+        goto out;
+    }
+    
+    if (tmp_name) {
+        if (vsfs_io_replace(tmp_name, output_name) != 0) {
+            fprintf(stderr, "Error: Cannot replace '%s' with '%s': %s\n", output_name, tmp_name, strerror(errno));
+            goto out;
+        }
+        free(tmp_name);
+        tmp_name = NULL;
+    }
+    
+    if (truncate_mode) {
+        printf("Truncated %u file(s) to %" PRIu64 " bytes, freed %u data blocks.\n",
+               truncated, truncate_size, freed_blocks);
+    } else {
+        printf("Removed %u file(s), freed %u inodes and %u data blocks.\n",
+               removed, freed_inodes, freed_blocks);
+    }
+    printf("Output image written to '%s'.\n", output_name);
+    status = 0;
+    
+out:
+    if (tmp_name) {
+        unlink(tmp_name);
+        free(tmp_name);
+    }
+    for (size_t i = 0; i < target_count; i++) free(targets[i].name);
+    free(targets);
+    free(img);
+    free(orig);
+    return status;
+}